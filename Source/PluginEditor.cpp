@@ -115,10 +115,20 @@ CrushOnYouAudioProcessorEditor::CrushOnYouAudioProcessorEditor (CrushOnYouAudioP
     depthLabel.setText("Bits", dontSendNotification);
     depthLabel.setJustificationType(Justification::centred);
     addAndMakeVisible(depthLabel);
+
+    // Signal statistics, measured while the editor is open unless the host switched them
+    telemetryLabel.setJustificationType(Justification::centred);
+    telemetryLabel.setFont(12.0f);
+    addAndMakeVisible(telemetryLabel);
+    audioProcessor.addTelemetryViewer();
+
+    startTimerHz(10);
 }
 
 CrushOnYouAudioProcessorEditor::~CrushOnYouAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.removeTelemetryViewer();
 }
 
 //==============================================================================
@@ -160,6 +170,8 @@ void CrushOnYouAudioProcessorEditor::resized()
     }
 
     mainGrid.performLayout(getLocalBounds());
+
+    telemetryLabel.setBounds(getLocalBounds().removeFromBottom(22));
 }
 
 void CrushOnYouAudioProcessorEditor::changeCrushMode(TextButton* pressed) {
@@ -212,7 +224,6 @@ void CrushOnYouAudioProcessorEditor::sliderValueChanged(Slider* slider) {
 
 void CrushOnYouAudioProcessorEditor::timerCallback() {
     // Animated knobs and sliders for parameter automation
-    DBG("Is this working");
     auto& params = processor.getParameters();
     AudioParameterInt* factor;
     AudioParameterInt* depth;
@@ -230,11 +241,28 @@ void CrushOnYouAudioProcessorEditor::timerCallback() {
 
     AudioParameterBool* bit;
     bool paramVal;
-    for (int i = 0; i < 31; i++) {
+    for (int i = 0; i < 32; i++) {
         bit = (AudioParameterBool*)params.getUnchecked(5+i);
         paramVal = bit->get();
-        bitBts[i].setToggleState(paramVal, true);
-        if (paramVal)
-            bitBts[i].setButtonText("1");
+        bitBts[i].setToggleState(paramVal, dontSendNotification); // sending would flip the bit back via onClick
+        bitBts[i].setButtonText(paramVal ? "1" : "0");
     }
+
+    // Telemetry readout
+    if (! audioProcessor.isTelemetryEnabled()) {
+        telemetryLabel.setText("Telemetry off", dontSendNotification);
+        return;
+    }
+
+    const Telemetry t = audioProcessor.getTelemetry();
+    auto dB = [](float gain) { return String(Decibels::gainToDecibels(gain), 1) + " dB"; };
+
+    telemetryLabel.setText("SNR " + (std::isinf(t.snrDb) ? String("inf") : String(t.snrDb, 1)) + " dB"
+        + "   ENOB " + String(t.effectiveBits, 1)
+        + "   In RMS " + dB(t.inputRms)
+        + "   Out RMS " + dB(t.outputRms)
+        + "   Peak " + dB(t.outputPeak)
+        + "   Clipped " + String(t.clippedSamples)
+        + "   NaN in/out " + String(t.nanInputSamples) + "/" + String(t.nanSamples),
+        dontSendNotification);
 }
\ No newline at end of file
@@ -50,6 +50,7 @@ private:
     Label mixLabel;
     Label maskLabel;
     Label highLable, lowLabel;
+    Label telemetryLabel;
 
     void changeCrushMode(TextButton *pressed);
     void changeMaskMode();
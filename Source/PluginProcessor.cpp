@@ -18,6 +18,7 @@ CrushOnYouAudioProcessor::CrushOnYouAudioProcessor()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  AudioChannelSet::stereo(), true)
+                       .withInput  ("Sidechain", AudioChannelSet::stereo(), false)
                       #endif
                        .withOutput ("Output", AudioChannelSet::stereo(), true)
                      #endif
@@ -93,43 +94,80 @@ CrushOnYouAudioProcessor::CrushOnYouAudioProcessor()
     
     for (int i = 0; i < 32; i++) {
         addParameter(temp = new AudioParameterBool("mask" + std::to_string(i), std::to_string(i), false));
-        bitMaskParams.push_back(temp);
-        isMaskUsed.push_back(false);
+        bitMaskParams[i] = temp;
     }
 
-    masks.push_back(mask0);
-    masks.push_back(mask1);
-    masks.push_back(mask2);
-    masks.push_back(mask3);
-    masks.push_back(mask4);
-    masks.push_back(mask5);
-    masks.push_back(mask6);
-    masks.push_back(mask7);
-    masks.push_back(mask8);
-    masks.push_back(mask9);
-    masks.push_back(mask10);
-    masks.push_back(mask11);
-    masks.push_back(mask12);
-    masks.push_back(mask13);
-    masks.push_back(mask14);
-    masks.push_back(mask15);
-    masks.push_back(mask16);
-    masks.push_back(mask17);
-    masks.push_back(mask18);
-    masks.push_back(mask19);
-    masks.push_back(mask20);
-    masks.push_back(mask21);
-    masks.push_back(mask22);
-    masks.push_back(mask23);
-    masks.push_back(mask24);
-    masks.push_back(mask25);
-    masks.push_back(mask26);
-    masks.push_back(mask27);
-    masks.push_back(mask28);
-    masks.push_back(mask29);
-    masks.push_back(mask30);
-    masks.push_back(mask31);
+    const unsigned maskList[32] = {
+        mask0, mask1, mask2, mask3, mask4, mask5, mask6, mask7,
+        mask8, mask9, mask10, mask11, mask12, mask13, mask14, mask15,
+        mask16, mask17, mask18, mask19, mask20, mask21, mask22, mask23,
+        mask24, mask25, mask26, mask27, mask28, mask29, mask30, mask31 };
+    std::copy(std::begin(maskList), std::end(maskList), masks);
+
+    // Sidechain params, added after the masks so the editor's param indices don't move
+    addParameter(scAmountParam = new AudioParameterFloat("scAmount",
+        "Sidechain Amount",
+        0.0f, // no modulation,
+        1.0f, // level fully drives bits and downsampling,
+        0.0f));
+    addParameter(envAttackParam = new AudioParameterFloat("envAttack",
+        "Envelope Attack",
+        NormalisableRange<float>(0.5f, 100.0f, 0.0f, 0.5f), // ms
+        5.0f));
+    addParameter(envReleaseParam = new AudioParameterFloat("envRelease",
+        "Envelope Release",
+        NormalisableRange<float>(5.0f, 1000.0f, 0.0f, 0.5f), // ms
+        150.0f));
+
+    // Modulation matrix params
+    addParameter(modRateParam = new AudioParameterChoice("modRate",
+        "Modulation Rate",
+        { "8", "16", "32", "64" }, // samples per control block,
+        2,
+        AudioParameterChoiceAttributes().withLabel("samples")));
+    addParameter(maskDensityParam = new AudioParameterFloat("maskDensity",
+        "Mask Density",
+        0.0f, // no selected bits masked,
+        1.0f, // every selected bit masked,
+        1.0f));
+
+    const StringArray lfoShapes = { "Sine", "Triangle", "Saw", "Square", "S&H" };
+    for (int i = 0; i < numLfos; i++) {
+        const std::string num = std::to_string(i + 1);
+        addParameter(lfoRateParams[i] = new AudioParameterFloat("lfo" + num + "Rate",
+            "LFO " + num + " Rate",
+            NormalisableRange<float>(0.01f, 20.0f, 0.0f, 0.3f), // Hz
+            1.0f));
+        addParameter(lfoShapeParams[i] = new AudioParameterChoice("lfo" + num + "Shape",
+            "LFO " + num + " Shape",
+            lfoShapes,
+            0));
+    }
+
+    // order has to match ModSource and ModDest
+    const StringArray modSources = { "LFO 1", "LFO 2", "Input Env", "Sidechain Env" };
+    const StringArray modDests = { "Mix", "Bit-Depth", "Downsample Factor", "Mask Density" };
+    for (int i = 0; i < numModSlots; i++) {
+        const std::string num = std::to_string(i + 1);
+        addParameter(modSourceParams[i] = new AudioParameterChoice("mod" + num + "Source",
+            "Mod " + num + " Source",
+            modSources,
+            lfo1Source));
+        addParameter(modDestParams[i] = new AudioParameterChoice("mod" + num + "Dest",
+            "Mod " + num + " Destination",
+            modDests,
+            mixDest));
+        addParameter(modAmountParams[i] = new AudioParameterFloat("mod" + num + "Amount",
+            "Mod " + num + " Amount",
+            -1.0f, // full range down,
+            1.0f, // full range up,
+            0.0f)); // off by default
+    }
 
+    addParameter(emulationParam = new AudioParameterChoice("emulation",
+        "Sampler Emulation",
+        { "Off", "SP-1200", "S950", "MPC60" }, // after Off, order matches SamplerEmulation::Model
+        0));
 }
 
 CrushOnYouAudioProcessor::~CrushOnYouAudioProcessor()
@@ -199,16 +237,41 @@ void CrushOnYouAudioProcessor::changeProgramName (int index, const String& newNa
 }
 
 //==============================================================================
-void CrushOnYouAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
+void CrushOnYouAudioProcessor::prepareToPlay (double newSampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    sampleRate = newSampleRate;
+
+    dsCount = 0;
+    std::fill(std::begin(dsSamp), std::end(dsSamp), 0.0f);
+    scEnv = inputEnv = 0.0f;
+    bitDepthMem = -1;
+    envBlockSizeMem = -1; // coefficients depend on the sample rate
+
+    std::fill(std::begin(lfoPhase), std::end(lfoPhase), 0.0f);
+    std::fill(std::begin(lfoHeld), std::end(lfoHeld), 0.0f);
+
+    maxBlockSize = jmax(1, samplesPerBlock);
+
+    // enough frames for a whole block at the fastest control rate
+    numControlFrames = maxBlockSize / minControlBlockSize + 1;
+
+    scratch.allocate(ScratchArena::bytesFor<ControlFrame>((size_t)numControlFrames));
+    controlFrames = scratch.take<ControlFrame>((size_t)numControlFrames);
+
+    for (int model = 0; model < SamplerEmulation::numModels; model++)
+        emulations[model].prepare((SamplerEmulation::Model)model, sampleRate);
+
+    telemetryWindow = TelemetryAccumulator();
+    telemetryTotals = Telemetry();
+    telemetryWindowSize = (int)(sampleRate / 10.0);
 }
 
 void CrushOnYouAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    controlFrames = nullptr;
+    numControlFrames = 0;
+
+    scratch.release();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -230,6 +293,15 @@ bool CrushOnYouAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    // Sidechain is optional, mono or stereo
+    if (layouts.inputBuses.size() > 1) {
+        auto sidechain = layouts.getChannelSet(true, 1);
+        if (! sidechain.isDisabled()
+         && sidechain != AudioChannelSet::mono()
+         && sidechain != AudioChannelSet::stereo())
+            return false;
+    }
    #endif
 
     return true;
@@ -238,67 +310,260 @@ bool CrushOnYouAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
 #endif
 
 void CrushOnYouAudioProcessor::updateParameters() {
-    setWetDryBalance(wetDryParam->get());
-    dsFactor = dsFactorParam->get();
-    bitDepth = bitDepthParam->get();
+    userMix = wetDryParam->get();
+    userDsFactor = dsFactor = dsFactorParam->get();
+    userBitDepth = bitDepth = bitDepthParam->get();
     masksEnabled = masksEnabledParam->get();
     if (masksEnabled) {
+        unsigned usedMasks = 0;
         for (int i = 0; i < 32; i++) {
-            isMaskUsed[i] = bitMaskParams[i]->get();
+            if (bitMaskParams[i]->get())
+                usedMasks |= masks[i];
+        }
+        // only rebuild the density table if the selection changed
+        if (usedMasks != usedMasksMem) {
+            numUsedMasks = 0;
+            for (int i = 0; i < 32; i++) {
+                if (usedMasks & masks[i]) {
+                    densityMasks[numUsedMasks + 1] = densityMasks[numUsedMasks] | masks[i];
+                    numUsedMasks++;
+                }
+            }
+            usedMasksMem = usedMasks;
         }
     }
+    maskDensity = maskDensityParam->get();
     crushMode = crushMethodParam->getIndex(); // using JUCE String gave weird results, so using int
+
+    // start a newly selected model from silence rather than whatever it held last time
+    emulationModel = emulationParam->getIndex() - 1;
+    if (emulationModel != emulationMem) {
+        if (emulationModel >= 0)
+            emulations[emulationModel].reset();
+        emulationMem = emulationModel;
+    }
+
+    controlBlockSize = minControlBlockSize << modRateParam->getIndex();
+
+    scAmount = scAmountParam->get();
+
+    // only update if the times or control rate have changed, saves two exp() per block
+    const float attack = envAttackParam->get(), release = envReleaseParam->get();
+    if (attack != envAttackMem || release != envReleaseMem || controlBlockSize != envBlockSizeMem) {
+        envAttackCoef = envCoefficient(attack);
+        envReleaseCoef = envCoefficient(release);
+        envAttackMem = attack;
+        envReleaseMem = release;
+        envBlockSizeMem = controlBlockSize;
+    }
+
+    for (int i = 0; i < numLfos; i++) {
+        lfoRate[i] = lfoRateParams[i]->get();
+        lfoShape[i] = lfoShapeParams[i]->getIndex();
+    }
+    for (int i = 0; i < numModSlots; i++) {
+        modSlots[i].source = modSourceParams[i]->getIndex();
+        modSlots[i].dest = modDestParams[i]->getIndex();
+        modSlots[i].amount = modAmountParams[i]->get();
+    }
 }
 
-void CrushOnYouAudioProcessor::decimate(float& sample, const int& index)
-{
-    if (index % dsFactor == 0) {
-        dsSamp = sample;
+float CrushOnYouAudioProcessor::envCoefficient(float timeMs) const {
+    // one-pole coefficient for a follower that only updates every controlBlockSize samples
+    return (float)std::exp(-controlBlockSize / (timeMs * 0.001 * sampleRate));
+}
+
+void CrushOnYouAudioProcessor::followEnvelope(float& env, const AudioBuffer<float>& source, int start, int numSamples) {
+    float level = 0.0f;
+    for (int ch = 0; ch < source.getNumChannels(); ch++)
+        level = jmax(level, source.getMagnitude(ch, start, numSamples)); // SIMD min/max scan
+
+    // coefficients are for a full control block, the last frame of a host block
+    // is often shorter so scale to its real length (c^(n/N) = exp(-n / (t*fs)))
+    float coef = level > env ? envAttackCoef : envReleaseCoef;
+    if (numSamples != controlBlockSize)
+        coef = std::pow(coef, (float)numSamples / controlBlockSize);
+
+    env = level + coef * (env - level);
+}
+
+float CrushOnYouAudioProcessor::advanceLfo(int lfo, int numSamples) {
+    // frames at the end of a host block can be shorter than controlBlockSize
+    float& phase = lfoPhase[lfo];
+    phase += lfoRate[lfo] * numSamples / (float)sampleRate;
+    if (phase >= 1.0f) {
+        phase -= (int)phase;
+        lfoHeld[lfo] = lfoRandom.nextFloat() * 2.0f - 1.0f;
+    }
+
+    switch (lfoShape[lfo]) {
+        case 0: return std::sin(MathConstants<float>::twoPi * phase);
+        case 1: return 1.0f - 4.0f * std::abs(phase - 0.5f);
+        case 2: return 2.0f * phase - 1.0f;
+        case 3: return phase < 0.5f ? 1.0f : -1.0f;
+        default: return lfoHeld[lfo];
     }
-    sample = dsSamp;
 }
 
-void CrushOnYouAudioProcessor::bitcrush(float& sample) {
-    switch (crushMode) {
-        case 0: bitcrushNormalStrategy(sample);
-            break;
-        case 1: bitcrushBitshiftStrategy(sample);
-            break;
+void CrushOnYouAudioProcessor::evaluateModulation(const AudioBuffer<float>& input, const AudioBuffer<float>& sidechain, int start, int numSamples) {
+    const int minBits = bitDepthParam->getRange().getStart();
+    const int maxBits = bitDepthParam->getRange().getEnd();
+    const int minFactor = dsFactorParam->getRange().getStart();
+    const int maxFactor = dsFactorParam->getRange().getEnd();
+
+    for (int frame = 0; frame * controlBlockSize < numSamples; frame++) {
+        const int offset = start + frame * controlBlockSize;
+        const int num = jmin(controlBlockSize, start + numSamples - offset);
+
+        // LFOs are bipolar, envelopes unipolar
+        float sources[numModSources];
+        for (int lfo = 0; lfo < numLfos; lfo++)
+            sources[lfo1Source + lfo] = advanceLfo(lfo, num);
+
+        followEnvelope(inputEnv, input, offset, num);
+        sources[inputEnvSource] = jmin(inputEnv, 1.0f);
+
+        if (sidechain.getNumChannels() > 0)
+            followEnvelope(scEnv, sidechain, offset, num);
+        else
+            scEnv = 0.0f;
+        sources[sidechainEnvSource] = jmin(scEnv, 1.0f);
+
+        // amounts are fractions of each destination's full range
+        float mod[numModDests] = {};
+        for (const auto& slot : modSlots)
+            mod[slot.dest] += slot.amount * sources[slot.source];
+
+        // the sidechain amount is a fixed route: louder -> fewer bits and more downsampling
+        const float scDepth = scAmount * sources[sidechainEnvSource];
+
+        auto& f = controlFrames[frame];
+
+        const float bits = userBitDepth - scDepth * (userBitDepth - minBits) + mod[bitDepthDest] * (maxBits - minBits);
+        f.bitDepth = jlimit(minBits, maxBits, roundToInt(bits));
+
+        const float factor = userDsFactor + scDepth * (maxFactor - userDsFactor) + mod[dsFactorDest] * (maxFactor - minFactor);
+        f.dsFactor = jlimit(minFactor, maxFactor, roundToInt(factor));
+
+        setWetDryBalance(jlimit(-1.0f, 1.0f, userMix + 2.0f * mod[mixDest]));
+        f.wetGain = wetGain;
+        f.dryGain = dryGain;
+
+        const float density = jlimit(0.0f, 1.0f, maskDensity + mod[maskDensityDest]);
+        f.mask = densityMasks[roundToInt(density * numUsedMasks)];
     }
 }
 
-void CrushOnYouAudioProcessor::bitcrushNormalStrategy(float& sample) {
+void CrushOnYouAudioProcessor::applyFrame(const ControlFrame& frame) {
+    bitDepth = frame.bitDepth;
+    dsFactor = frame.dsFactor;
+    wetGain = frame.wetGain;
+    dryGain = frame.dryGain;
+    activeMask = frame.mask;
+    updateCrushState();
+}
+
+void CrushOnYouAudioProcessor::renderControlBlocks(AudioBuffer<float>& buffer, int numChannels, int start, int numSamples, bool measuring) {
+    const Kernel kernel = measuring ? selectKernel<true>() : selectKernel<false>();
+
+    for (int frame = 0; frame * controlBlockSize < numSamples; frame++) {
+        const int offset = start + frame * controlBlockSize;
+        const int num = jmin(controlBlockSize, start + numSamples - offset);
+
+        applyFrame(controlFrames[frame]);
+
+        for (int ch = 0; ch < numChannels; ch++)
+            (this->*kernel)(buffer.getWritePointer(ch, offset), ch, num);
+
+        dsCount = (dsCount + num) % dsFactor;
+    }
+}
+
+void CrushOnYouAudioProcessor::updateCrushState() {
     // only update if bitdepth has changed
-    if (bitDepthMem != bitDepth){
-        ql = 1.0f / (pow(2, bitDepth) - 1.0f);
+    if (bitDepthMem != bitDepth) {
+        qlInv = (float)(pow(2, bitDepth) - 1.0);
+        ql = 1.0f / qlInv;
         bitDepthMem = bitDepth;
     }
-    sample = ql * ((int)(sample / ql));
+    // a shorter period than where we are now just starts a new one
+    if (dsCount >= dsFactor)
+        dsCount = 0;
 }
 
-void CrushOnYouAudioProcessor::bitcrushBitshiftStrategy(float& sample) {
-    float temp = sample;
+template <bool measured>
+CrushOnYouAudioProcessor::Kernel CrushOnYouAudioProcessor::selectKernel() const {
+    if (emulationModel >= 0)
+        return &CrushOnYouAudioProcessor::emulationKernel<measured>;
 
-    // yeah
-    int toShift = *(int*)&temp;
-    toShift >>= 27 - bitDepth;
-    toShift <<= 27 - bitDepth;
-    temp = *(float*)&toShift;
+    if (crushMode == 0)
+        return masksEnabled ? &CrushOnYouAudioProcessor::crushKernel<0, true, measured>
+                            : &CrushOnYouAudioProcessor::crushKernel<0, false, measured>;
 
-    sample = temp;
+    return masksEnabled ? &CrushOnYouAudioProcessor::crushKernel<1, true, measured>
+                        : &CrushOnYouAudioProcessor::crushKernel<1, false, measured>;
 }
 
-void CrushOnYouAudioProcessor::bitmask(float& sample) {
+template <int mode, bool masked, bool measured>
+void CrushOnYouAudioProcessor::crushKernel(float* data, int channel, int numSamples) {
+    float held = dsSamp[channel];
+    int count = dsCount;
 
-    float temp = sample;
-    int toMask = *(int*)&temp;
-    for (int i = 0; i < 32; i++) {
-        if (isMaskUsed[i]) {
-            toMask &= ~masks[i]; // 0 out bit at mask index
+    for (int samp = 0; samp < numSamples; samp++) {
+        // only the samples the decimator keeps need crushing
+        if (count == 0) {
+            held = data[samp];
+
+            if constexpr (mode == 0)
+                bitcrushNormalStrategy(held);
+            else
+                bitcrushBitshiftStrategy(held);
+
+            if constexpr (masked)
+                bitmask(held);
+
+            // the hold isn't quantization, only what crushing this sample lost counts
+            if constexpr (measured)
+                telemetryWindow.quantization.add(data[samp], held);
         }
+        if (++count == dsFactor)
+            count = 0;
+
+        data[samp] = dryGain*data[samp] + wetGain*held;
     }
-    temp = *(float*)&toMask;
-    sample = temp;
+    dsSamp[channel] = held;
+}
+
+template <bool measured>
+void CrushOnYouAudioProcessor::emulationKernel(float* data, int channel, int numSamples) {
+    auto& emulation = emulations[emulationModel];
+
+    for (int samp = 0; samp < numSamples; samp++)
+        data[samp] = dryGain*data[samp]
+                   + wetGain*emulation.processSample<measured>(data[samp], channel, &telemetryWindow.quantization);
+}
+
+void CrushOnYouAudioProcessor::bitcrushNormalStrategy(float& sample) {
+    sample = ql * ((int)(sample * qlInv));
+}
+
+void CrushOnYouAudioProcessor::bitcrushBitshiftStrategy(float& sample) {
+    // yeah. memcpy rather than the pointer cast so it stays defined once inlined
+    // into the kernels, compiles to the same register move.
+    // unsigned so the left shift of a negative sample isn't UB, same bits come out
+    unsigned toShift;
+    std::memcpy(&toShift, &sample, sizeof(float));
+    toShift >>= 27 - bitDepth;
+    toShift <<= 27 - bitDepth;
+    std::memcpy(&sample, &toShift, sizeof(float));
+}
+
+void CrushOnYouAudioProcessor::bitmask(float& sample) {
+
+    unsigned toMask;
+    std::memcpy(&toMask, &sample, sizeof(float));
+    toMask &= ~activeMask; // 0 out bits at every used mask index
+    std::memcpy(&sample, &toMask, sizeof(float));
 }
 
 void CrushOnYouAudioProcessor::setWetDryBalance(float userIn) {
@@ -320,29 +585,70 @@ void CrushOnYouAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuf
 
     updateParameters();
 
-    auto* channelL = buffer.getWritePointer(0);
-    auto* channelR = buffer.getWritePointer(1);
+    const int numSamples = buffer.getNumSamples();
+    const int numChannels = jmin(getMainBusNumOutputChannels(), maxChannels);
+    const bool hasSidechain = getBusCount(true) > 1 && getChannelCountOfBus(true, 1) > 0;
+
+    const auto input = getBusBuffer(buffer, true, 0);
+    AudioBuffer<float> sidechain;
+    if (hasSidechain)
+        sidechain = getBusBuffer(buffer, true, 1);
+
+    jassert(numControlFrames > 0); // prepareToPlay hasn't been called
+    if (numControlFrames == 0)
+        return;
 
-    for (int samp = 0; samp < buffer.getNumSamples(); samp++)
+    const bool measuring = isTelemetryEnabled();
+
+    // Modulation is evaluated once per control block into controlFrames, then the
+    // kernels run over each sub-block with fixed parameters. Blocks bigger than
+    // prepareToPlay promised are done in several passes.
+    for (int start = 0; start < numSamples; start += maxBlockSize)
     {
-        float tempL = channelL[samp], tempR = channelR[samp];
+        const int num = jmin(maxBlockSize, numSamples - start);
+        evaluateModulation(input, sidechain, start, num);
 
-        bitcrush(tempL);
-        bitcrush(tempR);
+        if (measuring)
+            for (int ch = 0; ch < numChannels; ch++)
+                telemetryWindow.addInput(buffer.getReadPointer(ch, start), num);
 
-        if (masksEnabled) {
-            bitmask(tempL);
-            bitmask(tempR);
-        }
+        renderControlBlocks(buffer, numChannels, start, num, measuring);
 
-        decimate(tempL, samp);
-        decimate(tempR, samp);
+        if (measuring)
+            for (int ch = 0; ch < numChannels; ch++)
+                telemetryWindow.addOutput(buffer.getReadPointer(ch, start), num);
+    }
 
-        channelL[samp] = dryGain*channelL[samp] + wetGain*tempL;
-        channelR[samp] = dryGain*channelR[samp] + wetGain*tempR;
+    if (measuring && telemetryWindow.numSamples >= telemetryWindowSize * numChannels) {
+        telemetryWindow.finishWindow(telemetryTotals);
+        telemetrySnapshot.publish(telemetryTotals);
     }
 }
 
+void CrushOnYouAudioProcessor::setTelemetryEnabled(bool shouldBeEnabled) {
+    telemetrySwitch.store(shouldBeEnabled ? 1 : 0);
+}
+
+bool CrushOnYouAudioProcessor::isTelemetryEnabled() const {
+    const int explicitSwitch = telemetrySwitch.load(std::memory_order_relaxed);
+    if (explicitSwitch >= 0)
+        return explicitSwitch == 1;
+
+    return telemetryViewers.load(std::memory_order_relaxed) > 0;
+}
+
+void CrushOnYouAudioProcessor::addTelemetryViewer() {
+    ++telemetryViewers;
+}
+
+void CrushOnYouAudioProcessor::removeTelemetryViewer() {
+    --telemetryViewers;
+}
+
+Telemetry CrushOnYouAudioProcessor::getTelemetry() const {
+    return telemetrySnapshot.read();
+}
+
 //==============================================================================
 bool CrushOnYouAudioProcessor::hasEditor() const
 {
@@ -9,6 +9,9 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SamplerEmulation.h"
+#include "Telemetry.h"
+#include "ScratchArena.h"
 
 using namespace juce;
 
@@ -58,10 +61,42 @@ public:
     void getStateInformation (MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    //==============================================================================
+    // Signal statistics. Safe to call from any thread.
+    // setTelemetryEnabled is the explicit switch and always wins. Until it's
+    // called, statistics are only gathered while a viewer (the editor) is open.
+    void setTelemetryEnabled(bool shouldBeEnabled);
+    bool isTelemetryEnabled() const;
+    Telemetry getTelemetry() const;
+
+    void addTelemetryViewer();
+    void removeTelemetryViewer();
+
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CrushOnYouAudioProcessor);
 
+    // Modulation matrix layout ====================================================
+
+    static constexpr int numLfos = 2;
+    static constexpr int numModSlots = 4;
+
+    enum ModSource { lfo1Source, lfo2Source, inputEnvSource, sidechainEnvSource, numModSources };
+    enum ModDest { mixDest, bitDepthDest, dsFactorDest, maskDensityDest, numModDests };
+
+    struct ModSlot {
+        int source = lfo1Source;
+        int dest = mixDest;
+        float amount = 0.0f;
+    };
+
+    // everything the kernels need for one control block
+    struct ControlFrame {
+        int bitDepth, dsFactor;
+        float wetGain, dryGain;
+        unsigned mask;
+    };
+
     // User param variables ========================================================
 
     AudioParameterFloat* wetDryParam;
@@ -69,35 +104,99 @@ private:
     AudioParameterInt* bitDepthParam;
     AudioParameterChoice* crushMethodParam;
     AudioParameterBool* masksEnabledParam;
-    std::vector<AudioParameterBool*> bitMaskParams;
+    AudioParameterBool* bitMaskParams[32];
+    AudioParameterFloat* scAmountParam;
+    AudioParameterFloat* envAttackParam;
+    AudioParameterFloat* envReleaseParam;
+    AudioParameterChoice* modRateParam;
+    AudioParameterFloat* maskDensityParam;
+    AudioParameterFloat* lfoRateParams[numLfos];
+    AudioParameterChoice* lfoShapeParams[numLfos];
+    AudioParameterChoice* modSourceParams[numModSlots];
+    AudioParameterChoice* modDestParams[numModSlots];
+    AudioParameterFloat* modAmountParams[numModSlots];
+    AudioParameterChoice* emulationParam;
 
     // Private algo variables ======================================================
 
+    static constexpr int maxChannels = 2;
+    static constexpr int minControlBlockSize = 8;
+    int controlBlockSize = 32; // samples between modulation updates
+
+    double sampleRate = 44100.0;
+    int maxBlockSize = 0; // samplesPerBlock from prepareToPlay
+
+    float userMix;
     float wetGain, dryGain;
 
+    int userDsFactor; // value from the parameter, dsFactor is the modulated one
     int dsFactor;
-    float dsSamp; // current sample kept in decimation algorithm
+    int dsCount = 0; // position inside the current decimation period
+    float dsSamp[maxChannels] = {}; // current sample kept in decimation algorithm
 
     int crushMode;
 
+    int userBitDepth;
     int bitDepth;
     int bitDepthMem = -1;
-    float ql;
+    float ql, qlInv;
 
     bool masksEnabled = false;
-    std::vector<unsigned> masks;
-    std::vector<bool> isMaskUsed;
+    unsigned activeMask = 0; // selected masks applied in the current control block
+    unsigned masks[32];
+    unsigned usedMasksMem = 0; // selected masks OR'd together, last time densityMasks was built
+
+    // densityMasks[n] is the lowest n selected masks OR'd together
+    float maskDensity = 1.0f;
+    int numUsedMasks = 0;
+    unsigned densityMasks[33] = {};
+
+    // envelope followers, run once per control block
+    float scAmount = 0.0f;
+    float scEnv = 0.0f;
+    float inputEnv = 0.0f;
+    float envAttackCoef = 0.0f, envReleaseCoef = 0.0f;
+    float envAttackMem = -1.0f, envReleaseMem = -1.0f;
+    int envBlockSizeMem = -1;
+
+    int lfoShape[numLfos] = {};
+    float lfoRate[numLfos] = {};
+    float lfoPhase[numLfos] = {};
+    float lfoHeld[numLfos] = {}; // sample & hold value
+    Random lfoRandom;
+
+    ModSlot modSlots[numModSlots];
+
+    // Scratch memory ===============================================================
+    // All of it lives in one arena carved up in prepareToPlay, processBlock
+    // doesn't allocate, lock or make system calls.
+
+    ScratchArena scratch;
+    ControlFrame* controlFrames = nullptr; // one per control block
+    int numControlFrames = 0;
+
+    // every model is built in prepareToPlay so switching is just an index change
+    SamplerEmulation emulations[SamplerEmulation::numModels];
+    int emulationModel = -1; // -1 = off
+    int emulationMem = -1;
+
+    // stream stats come from the buffer either side of the kernels, the
+    // quantization error from the kernels themselves
+    std::atomic<int> telemetrySwitch { -1 }; // -1 = not set, 0 = off, 1 = on
+    std::atomic<int> telemetryViewers { 0 };
+    TelemetryAccumulator telemetryWindow;
+    Telemetry telemetryTotals;
+    TelemetrySnapshot telemetrySnapshot;
+    int telemetryWindowSize = 4410; // samples per published window, ~100ms
 
     // Algo functions ==============================================================
 
     void setWetDryBalance(float userIn);
-    void decimate(float& sample, const int& index);
-    void bitcrush(float& sample);
 
         // uses equation from Pirkle page 544
         void bitcrushNormalStrategy(float& sample);
 
-        // bitshift based crush, uses a hacky pointer cast trick from the fast inverse sqrt algorithm.
+        // bitshift based crush, uses the float-as-int trick from the fast inverse sqrt algorithm.
         // https://en.wikipedia.org/wiki/Fast_inverse_square_root#Overview_of_the_code
         void bitcrushBitshiftStrategy(float& sample);
 
@@ -105,6 +204,32 @@ private:
     // I think it's cool even if it's not necessarily a bit-depth reduction
     void bitmask(float& sample);
 
+    // Peak follower over one bus (input or sidechain), updated once per control block.
+    // Coefficients are for a full control block and rescaled when the frame is shorter.
+    void followEnvelope(float& env, const AudioBuffer<float>& source, int start, int numSamples);
+
+    // Fills controlFrames for numSamples from start. Reads the input before it gets crushed.
+    void evaluateModulation(const AudioBuffer<float>& input, const AudioBuffer<float>& sidechain, int start, int numSamples);
+    void renderControlBlocks(AudioBuffer<float>& buffer, int numChannels, int start, int numSamples, bool measuring);
+    float advanceLfo(int lfo, int numSamples);
+    void applyFrame(const ControlFrame& frame);
+
+    // One kernel per crush mode / mask / telemetry combination so the sample loop doesn't
+    // branch on them. Parameters are held constant for the length of a call.
+    using Kernel = void (CrushOnYouAudioProcessor::*)(float* data, int channel, int numSamples);
+
+    template <int mode, bool masked, bool measured>
+    void crushKernel(float* data, int channel, int numSamples);
+
+    // sampler model replaces crush, masks and decimation, mix still applies
+    template <bool measured>
+    void emulationKernel(float* data, int channel, int numSamples);
+
+    template <bool measured>
+    Kernel selectKernel() const;
+    void updateCrushState();
+
     // Helpers
     void updateParameters();
+    float envCoefficient(float timeMs) const;
 };
@@ -0,0 +1,177 @@
+/*
+  ==============================================================================
+
+    Vintage sampler emulation: converter nonlinearity, fixed hardware sample
+    rate and anti-aliasing / anti-imaging filters of a few classic lo-fi boxes.
+
+  ==============================================================================
+*/
+
+#include "SamplerEmulation.h"
+
+using namespace juce;
+
+// Rates and bit depths are the hardware's. Filter corners, ladder error and drive
+// are by ear against recordings, not measurements.
+const SamplerEmulation::Spec SamplerEmulation::specs[numModels] = {
+    // SP-1200: 12-bit at 26.04 kHz, no input anti-aliasing so it folds over
+    { 26040.0, 12, 0.004f, 1.6f, 0.0f, 0.0, 12000.0 },
+    // S950: 12-bit, at a typical 32 kHz setting with its filter tracking the rate
+    { 32000.0, 12, 0.0015f, 1.0f, 0.0f, 14000.0, 14000.0 },
+    // MPC60: 12-bit non-linear (companded) at 40 kHz
+    { 40000.0, 12, 0.001f, 1.2f, 8.0f, 17000.0, 17000.0 },
+};
+
+void SamplerEmulation::Biquad::makeLowPass(double sampleRate, double cutoff, double q) {
+    // RBJ cookbook low pass
+    const double w0 = MathConstants<double>::twoPi * cutoff / sampleRate;
+    const double alpha = std::sin(w0) / (2.0 * q);
+    const double cosw0 = std::cos(w0);
+    const double a0 = 1.0 + alpha;
+
+    b0 = (float)((1.0 - cosw0) / 2.0 / a0);
+    b1 = (float)((1.0 - cosw0) / a0);
+    b2 = b0;
+    a1 = (float)(-2.0 * cosw0 / a0);
+    a2 = (float)((1.0 - alpha) / a0);
+}
+
+void SamplerEmulation::prepare(Model model, double hostSampleRate) {
+    const Spec& spec = specs[model];
+    step = spec.hardwareRate / hostSampleRate;
+
+    // Butterworth section Qs, corners kept under the host's nyquist
+    constexpr double qs[numSections] = { 0.54119610, 1.30656296 };
+    const double maxCutoff = 0.45 * hostSampleRate;
+
+    hasInputFilter = spec.inputCutoff > 0.0;
+    for (int i = 0; i < numSections; i++) {
+        if (hasInputFilter)
+            inputFilter[i].makeLowPass(hostSampleRate, jmin(spec.inputCutoff, maxCutoff), qs[i]);
+        outputFilter[i].makeLowPass(hostSampleRate, jmin(spec.outputCutoff, maxCutoff), qs[i]);
+    }
+
+    const auto& tables = getTables(model);
+    binScale = (float)(tables.binCodes.size() - 1) / 2.0f;
+    levels = tables.levels.data();
+    thresholds = tables.thresholds.data();
+    binCodes = tables.binCodes.data();
+    inputLevels = tables.inputLevels.data();
+    reset();
+}
+
+void SamplerEmulation::reset() {
+    for (auto& state : channels)
+        state = ChannelState();
+}
+
+const SamplerEmulation::ConverterTables& SamplerEmulation::getTables(Model model) {
+    // built once on first use and shared by every instance instead of a copy each
+    static const auto tables = [] {
+        std::array<ConverterTables, numModels> built;
+        for (int m = 0; m < numModels; m++) {
+            auto& t = built[(size_t)m];
+            t.levels = buildLevelTable(specs[m]);
+            t.thresholds = buildThresholdTable(specs[m]);
+            t.binCodes = buildBinTable(t.thresholds, binsPerCode << specs[m].bits);
+            t.inputLevels = buildInputLevelTable(specs[m], t.levels);
+        }
+        return built;
+    }();
+
+    return tables[(size_t)model];
+}
+
+std::vector<float> SamplerEmulation::buildLevelTable(const Spec& spec) {
+    const int numCodes = 1 << spec.bits;
+    const int half = numCodes / 2;
+
+    // DAC ladder with fixed weight errors on the upper bits, so every instance
+    // has the same (slightly wrong) staircase
+    std::vector<double> weights((size_t)spec.bits);
+    for (int bit = 0; bit < spec.bits; bit++) {
+        const double pattern = ((bit * 5) % 7 - 3) / 3.0; // -1..1
+        const double error = bit >= spec.bits - 4 ? spec.ladderError * pattern : 0.0;
+        weights[(size_t)bit] = (1 << bit) * (1.0 + error);
+    }
+
+    auto dac = [&](int offsetCode) {
+        double level = 0.0;
+        for (int bit = 0; bit < spec.bits; bit++)
+            if (offsetCode & (1 << bit))
+                level += weights[(size_t)bit];
+        return level;
+    };
+
+    const double zero = dac(half);
+    const double fullScale = dac(numCodes - 1) - zero;
+    const double muLog = std::log1p((double)spec.mu);
+
+    // codes are two's complement, offset binary for the ladder
+    std::vector<float> levels((size_t)numCodes);
+    for (int offsetCode = 0; offsetCode < numCodes; offsetCode++) {
+        double level = (dac(offsetCode) - zero) / fullScale;
+
+        if (spec.mu > 0.0f)
+            level = (level < 0.0 ? -1.0 : 1.0) * std::expm1(std::abs(level) * muLog) / spec.mu;
+
+        levels[(size_t)offsetCode] = (float)level;
+    }
+    return levels;
+}
+
+std::vector<float> SamplerEmulation::buildThresholdTable(const Spec& spec) {
+    const int numCodes = 1 << spec.bits;
+    const int half = numCodes / 2;
+    const double muLog = std::log1p((double)spec.mu);
+
+    // The encoder saturates (drive), compands (mu) and rounds to half - 1 steps
+    // either side of zero. Each rounding boundary is taken back through both
+    // curves to the input level where it happens. Boundaries the front end
+    // can't reach go to +-inf so the search never stops on them.
+    std::vector<float> thresholds((size_t)numCodes, std::numeric_limits<float>::infinity());
+    for (int i = 0; i < numCodes - 1; i++) {
+        double y = (i - half + 0.5) / (half - 1); // between code i and i + 1
+
+        if (spec.mu > 0.0f)
+            y = (y < 0.0 ? -1.0 : 1.0) * std::expm1(std::abs(y) * muLog) / spec.mu;
+
+        if (spec.drive != 1.0f) {
+            const double saturated = y * spec.drive;
+            y = std::abs(saturated) < 1.0 ? std::atanh(saturated) / spec.drive
+                                          : (y < 0.0 ? -1.0 : 1.0) * std::numeric_limits<double>::infinity();
+        }
+
+        thresholds[(size_t)i] = (float)y;
+    }
+    return thresholds;
+}
+
+std::vector<uint16> SamplerEmulation::buildBinTable(const std::vector<float>& thresholds, int numBins) {
+    // Thresholds below each bin's lower edge, less a margin so float rounding of
+    // the index can only leave the code short (convert() steps up), never over.
+    std::vector<uint16> binCodes((size_t)numBins + 1);
+    for (int bin = 0; bin <= numBins; bin++) {
+        const float lowEdge = (float)(-1.0 + 2.0 * bin / numBins - 1.0e-6);
+        const auto below = std::lower_bound(thresholds.begin(), thresholds.end(), lowEdge);
+        binCodes[(size_t)bin] = (uint16)(below - thresholds.begin());
+    }
+    return binCodes;
+}
+
+std::vector<float> SamplerEmulation::buildInputLevelTable(const Spec& spec, const std::vector<float>& levels) {
+    // Levels are already expanded, so only the drive is undone. Telemetry
+    // compares these with the converter's input, which leaves ADC rounding and
+    // DAC ladder error but not the saturation. Levels past what the front end
+    // can produce are never reached.
+    if (spec.drive == 1.0f)
+        return levels;
+
+    std::vector<float> inputLevels(levels.size());
+    for (size_t code = 0; code < levels.size(); code++) {
+        const double saturated = levels[code] * (double)spec.drive;
+        inputLevels[code] = std::abs(saturated) < 1.0 ? (float)(std::atanh(saturated) / spec.drive)
+                                                      : (saturated < 0.0 ? -1.0f : 1.0f);
+    }
+    return inputLevels;
+}
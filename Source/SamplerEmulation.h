@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    Vintage sampler emulation: converter nonlinearity, fixed hardware sample
+    rate and anti-aliasing / anti-imaging filters of a few classic lo-fi boxes.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Telemetry.h"
+
+using namespace juce;
+
+//==============================================================================
+/**
+    Everything that depends on the model and host rate (the converter tables and
+    the filter coefficients) is built in prepare(), so processSample() is a fixed
+    amount of work: two 4-pole filters, a phase step and, per conversion, an
+    ADC lookup over precomputed decision thresholds and one DAC level lookup.
+    Converter tables only depend on the model, so all instances share them.
+
+    The measured variant also adds each conversion's rounding error to a
+    QuantizationAccumulator, in the input's terms so the deliberate front end
+    saturation doesn't count as error.
+*/
+class SamplerEmulation
+{
+public:
+    enum Model { sp1200, s950, mpc60, numModels };
+
+    static constexpr int maxChannels = 2;
+
+    // Allocates, so call from prepareToPlay rather than the audio thread
+    void prepare(Model model, double hostSampleRate);
+    void reset();
+
+    template <bool measured = false>
+    float processSample(float sample, int channel, QuantizationAccumulator* quantization = nullptr)
+    {
+        auto& state = channels[channel];
+
+        // a NaN or inf would stay in the filter state forever, treat it as silence
+        if (! std::isfinite(sample))
+            sample = 0.0f;
+
+        if (hasInputFilter)
+            for (int i = 0; i < numSections; i++)
+                sample = inputFilter[i].process(sample, state.input[i]);
+
+        // Fractional resampling to the hardware rate. When a conversion falls
+        // between two host samples we interpolate to the exact instant and hold
+        // the converted value until the next one.
+        state.phase += step;
+        if (state.phase >= 1.0) {
+            state.phase -= (int)state.phase; // more than one conversion per sample when the host is slower
+            const float t = 1.0f - (float)(state.phase / step);
+            state.held = convert<measured>(state.last + t * (sample - state.last), quantization);
+        }
+        state.last = sample;
+
+        float out = state.held;
+        for (int i = 0; i < numSections; i++)
+            out = outputFilter[i].process(out, state.output[i]);
+
+        return out;
+    }
+
+private:
+    struct Spec {
+        double hardwareRate;
+        int bits;
+        float ladderError; // relative weight error of the DAC's upper bits
+        float drive;       // analogue front end saturation, 1 = clean
+        float mu;          // companding curve, 0 = linear converter
+        double inputCutoff; // 0 = no anti-aliasing filter
+        double outputCutoff;
+    };
+
+    static const Spec specs[numModels];
+
+    struct BiquadState { float z1 = 0.0f, z2 = 0.0f; };
+
+    struct Biquad {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+
+        void makeLowPass(double sampleRate, double cutoff, double q);
+
+        float process(float x, BiquadState& s) const
+        {
+            const float y = b0*x + s.z1;
+            s.z1 = b1*x - a1*y + s.z2;
+            s.z2 = b2*x - a2*y;
+            return y;
+        }
+    };
+
+    // 4th order Butterworth as two biquads
+    static constexpr int numSections = 2;
+
+    struct ChannelState {
+        BiquadState input[numSections], output[numSections];
+        double phase = 0.0;
+        float last = 0.0f, held = 0.0f;
+    };
+
+    // ADC: the code is how many decision thresholds lie at or below the input.
+    // A fine table indexed by the input gives the code at the bin's lower edge,
+    // bins are narrower than the closest thresholds so that is at most one
+    // step short. DAC: the code's output level.
+    template <bool measured>
+    float convert(float sample, QuantizationAccumulator* quantization) const
+    {
+        const float x = jlimit(-1.0f, 1.0f, sample);
+
+        int code = binCodes[(int)((x + 1.0f) * binScale)]; // offset binary
+        while (thresholds[code] <= x)
+            code++;
+
+        if constexpr (measured)
+            quantization->add(x, inputLevels[code]);
+
+        return levels[code];
+    }
+
+    static constexpr int binsPerCode = 4;
+
+    struct ConverterTables {
+        std::vector<float> levels;      // output level for every offset binary code
+        std::vector<float> thresholds;  // input where code i turns into code i + 1, +inf last
+        std::vector<uint16> binCodes;   // code at the lower edge of each input bin over -1..1
+        std::vector<float> inputLevels; // input that the front end would turn into each level
+    };
+
+    static std::vector<float> buildLevelTable(const Spec& spec);
+    static std::vector<float> buildThresholdTable(const Spec& spec);
+    static std::vector<uint16> buildBinTable(const std::vector<float>& thresholds, int numBins);
+    static std::vector<float> buildInputLevelTable(const Spec& spec, const std::vector<float>& levels);
+    static const ConverterTables& getTables(Model model);
+
+    Biquad inputFilter[numSections], outputFilter[numSections];
+    bool hasInputFilter = false;
+    double step = 1.0; // hardware samples per host sample
+
+    ChannelState channels[maxChannels];
+    float binScale = 1.0f;
+    const float* levels = nullptr;
+    const float* thresholds = nullptr;
+    const uint16* binCodes = nullptr;
+    const float* inputLevels = nullptr;
+};
@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    One block of scratch memory for everything processBlock needs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+using namespace juce;
+
+//==============================================================================
+/**
+    Sized and carved up in prepareToPlay, so the audio thread only ever uses
+    pointers into memory that already exists. Add up bytesFor() for every
+    buffer, allocate() once, then take() them in any order.
+*/
+class ScratchArena
+{
+public:
+    static constexpr size_t alignment = 32; // wide enough for AVX loads
+
+    template <typename T>
+    static size_t bytesFor(size_t count)
+    {
+        return (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Allocates, never call from the audio thread
+    void allocate(size_t numBytes)
+    {
+        storage.allocate(numBytes + alignment, true);
+        capacity = numBytes;
+        used = 0;
+    }
+
+    void release()
+    {
+        storage.free();
+        capacity = used = 0;
+    }
+
+    template <typename T>
+    T* take(size_t count)
+    {
+        const size_t bytes = bytesFor<T>(count);
+        jassert(used + bytes <= capacity); // forgot to count it in allocate()
+        if (used + bytes > capacity)
+            return nullptr;
+
+        auto base = (reinterpret_cast<uintptr_t>(storage.get()) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        T* block = reinterpret_cast<T*>(base + used);
+        used += bytes;
+        return block;
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+private:
+    HeapBlock<char> storage;
+    size_t capacity = 0, used = 0;
+};
@@ -0,0 +1,206 @@
+/*
+  ==============================================================================
+
+    Signal statistics gathered in processBlock and published to other threads.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+using namespace juce;
+
+//==============================================================================
+/**
+    What one instance did to the signal. Levels cover the last published window,
+    the clip and NaN/inf counts are totals since prepareToPlay.
+*/
+struct Telemetry
+{
+    float snrDb = 0.0f;         // quantizer input power against the error it added
+    float effectiveBits = 0.0f; // from the SNR, (snr - 1.76) / 6.02
+    float inputRms = 0.0f;
+    float outputRms = 0.0f;
+    float outputPeak = 0.0f;
+    uint64 clippedSamples = 0;  // |output| > 1
+    uint64 nanSamples = 0;      // NaN or inf output
+    uint64 nanInputSamples = 0; // NaN or inf input
+};
+
+//==============================================================================
+/**
+    Power going into a quantizer and of the error it adds, summed by the kernel
+    right where the rounding happens. Filters, resampling and the decimator's
+    hold delay the signal, so comparing the plugin's input with its output
+    would count that delay as error.
+*/
+struct QuantizationAccumulator
+{
+    double signalPower = 0.0, errorPower = 0.0;
+
+    void add(float before, float after)
+    {
+        const float e = after - before;
+        if (e - e == 0.0f) { // NaN / inf are counted on the output instead
+            signalPower += before*before;
+            errorPower += e*e;
+        }
+    }
+};
+
+//==============================================================================
+/**
+    Running sums for one window. The stream loops keep several independent
+    lanes so the compiler can turn them into SIMD without reassociating float
+    adds.
+*/
+struct TelemetryAccumulator
+{
+    static constexpr int lanes = 8;
+
+    double inputPower = 0.0, outputPower = 0.0;
+    float outputPeak = 0.0f;
+    uint64 clipped = 0, nans = 0, nanInputs = 0;
+    int64 numSamples = 0;
+    QuantizationAccumulator quantization;
+
+    // call before the kernels overwrite the buffer
+    void addInput(const float* input, int num)
+    {
+        float in[lanes] = {};
+        int nanIn[lanes] = {};
+
+        auto step = [&](int l, float x) {
+            // x - x is only non-zero (NaN) for NaN and inf, and stays a vector compare.
+            // Bad samples count as silence so one can't poison the sums.
+            const bool bad = ! (x - x == 0.0f);
+            x = bad ? 0.0f : x;
+            in[l] += x*x;
+            nanIn[l] += bad ? 1 : 0;
+        };
+
+        int i = 0;
+        for (; i + lanes <= num; i += lanes)
+            for (int l = 0; l < lanes; l++)
+                step(l, input[i + l]);
+        for (; i < num; i++)
+            step(0, input[i]);
+
+        for (int l = 0; l < lanes; l++) {
+            inputPower += in[l];
+            nanInputs += (uint64)nanIn[l];
+        }
+    }
+
+    void addOutput(const float* output, int num)
+    {
+        float out[lanes] = {}, peak[lanes] = {};
+        int clip[lanes] = {}, nan[lanes] = {};
+
+        auto step = [&](int l, float y) {
+            const bool bad = ! (y - y == 0.0f);
+            y = bad ? 0.0f : y;
+            const float a = std::abs(y);
+            out[l] += y*y;
+            peak[l] = a > peak[l] ? a : peak[l];
+            clip[l] += a > 1.0f ? 1 : 0;
+            nan[l] += bad ? 1 : 0;
+        };
+
+        int i = 0;
+        for (; i + lanes <= num; i += lanes)
+            for (int l = 0; l < lanes; l++)
+                step(l, output[i + l]);
+        for (; i < num; i++)
+            step(0, output[i]);
+
+        for (int l = 0; l < lanes; l++) {
+            outputPower += out[l];
+            outputPeak = jmax(outputPeak, peak[l]);
+            clipped += (uint64)clip[l];
+            nans += (uint64)nan[l];
+        }
+        numSamples += num;
+    }
+
+    // Turns the window into levels, carries the totals over and starts a new window
+    void finishWindow(Telemetry& t)
+    {
+        const double n = (double)jmax((int64)1, numSamples);
+
+        if (quantization.signalPower <= 0.0) {
+            t.snrDb = t.effectiveBits = 0.0f; // nothing was quantized
+        }
+        else if (quantization.errorPower <= 0.0) {
+            t.snrDb = std::numeric_limits<float>::infinity();
+            t.effectiveBits = 24.0f; // untouched, as good as a float mantissa
+        }
+        else {
+            t.snrDb = (float)(10.0 * std::log10(quantization.signalPower / quantization.errorPower));
+            t.effectiveBits = jlimit(0.0f, 24.0f, (t.snrDb - 1.76f) / 6.02f);
+        }
+
+        t.inputRms = (float)std::sqrt(inputPower / n);
+        t.outputRms = (float)std::sqrt(outputPower / n);
+        t.outputPeak = outputPeak;
+        t.clippedSamples += clipped;
+        t.nanSamples += nans;
+        t.nanInputSamples += nanInputs;
+
+        *this = TelemetryAccumulator();
+    }
+};
+
+//==============================================================================
+/**
+    Single writer (the audio thread), any number of readers. A sequence lock
+    over relaxed atomic words, so publishing never blocks and readers just retry
+    if they caught a write half way.
+*/
+class TelemetrySnapshot
+{
+public:
+    void publish(const Telemetry& t)
+    {
+        uint64 words[numWords] = {};
+        std::memcpy(words, &t, sizeof(Telemetry));
+
+        const uint32 seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed); // odd while writing
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (int i = 0; i < numWords; i++)
+            data[i].store(words[i], std::memory_order_relaxed);
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    Telemetry read() const
+    {
+        uint64 words[numWords];
+        for (;;) {
+            const uint32 before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+
+            for (int i = 0; i < numWords; i++)
+                words[i] = data[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+                break;
+        }
+
+        Telemetry t;
+        std::memcpy(&t, words, sizeof(Telemetry));
+        return t;
+    }
+
+private:
+    static constexpr int numWords = (int)((sizeof(Telemetry) + sizeof(uint64) - 1) / sizeof(uint64));
+
+    std::atomic<uint32> sequence { 0 };
+    std::atomic<uint64> data[numWords] = {};
+};
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    Regression check: modulation must not depend on the host block size.
+
+    The same signal is rendered with host blocks of 48 and 64 samples. With a
+    32 sample control block the 48 sample host gets 32 + 16 sample frames and
+    the 64 sample host 32 + 32, so their frames end together every 96 samples.
+    An LFO and the input envelope are each routed to Mix, with a DC input so
+    the output only depends on the modulation value. At those shared frame
+    ends both renders have to agree.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+#include "TestHelpers.h"
+
+#include <functional>
+#include <iostream>
+
+using namespace juce;
+
+//==============================================================================
+static constexpr double sampleRate = 48000.0;
+static constexpr int controlBlockSize = 32; // modRate "32"
+static constexpr int commonFrameEnd = 96;   // lcm of 48 and 32 (64 is a multiple of 32)
+static constexpr int length = commonFrameEnd * 50;
+
+using Setup = std::function<void(AudioProcessor&)>;
+
+// Mix in the middle and a coarse crush, so any change in Mix shows in the output
+static void setCommonParameters(AudioProcessor& processor)
+{
+    setParameter(processor, "Mix", 0.0f);
+    setParameter(processor, "bitDepth", 2);
+    setParameter(processor, "dsFactor", 1);
+    setParameter(processor, "masksEnabled", 0);
+    setParameter(processor, "modRate", 2);
+    setParameter(processor, "mod1Dest", 0); // Mix
+    setParameter(processor, "mod1Amount", 0.4f);
+}
+
+// Renders channel 0 of input through a fresh processor in host blocks of blockSize
+static std::vector<float> render(int blockSize, const Setup& setup, const std::vector<float>& input)
+{
+    CrushOnYouAudioProcessor processor;
+    setCommonParameters(processor);
+    setup(processor);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    const int numChannels = jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    AudioBuffer<float> block(numChannels, blockSize);
+    MidiBuffer midi;
+    std::vector<float> output(input.size());
+
+    for (int start = 0; start < (int)input.size(); start += blockSize) {
+        const int num = jmin(blockSize, (int)input.size() - start);
+        for (int ch = 0; ch < numChannels; ch++)
+            for (int i = 0; i < blockSize; i++)
+                block.setSample(ch, i, i < num ? input[(size_t)(start + i)] : 0.0f);
+
+        processor.processBlock(block, midi);
+
+        for (int i = 0; i < num; i++)
+            output[(size_t)(start + i)] = block.getSample(0, i);
+    }
+
+    processor.releaseResources();
+    return output;
+}
+
+static bool check(const char* name, const Setup& setup, const std::vector<float>& input)
+{
+    const auto small = render(48, setup, input);
+    const auto large = render(64, setup, input);
+
+    float maxDiff = 0.0f, lowest = 1.0f, highest = -1.0f;
+    for (int end = commonFrameEnd; end <= length; end += commonFrameEnd) {
+        const size_t last = (size_t)(end - 1); // last sample of a frame ending on both hosts
+        maxDiff = jmax(maxDiff, std::abs(small[last] - large[last]));
+        lowest = jmin(lowest, large[last]);
+        highest = jmax(highest, large[last]);
+    }
+
+    // the modulation has to actually move the output or the comparison proves nothing
+    const bool moving = highest - lowest > 0.01f;
+    const bool pass = moving && maxDiff < 1.0e-4f;
+
+    std::cout << (pass ? "PASS " : "FAIL ") << name << ": max difference " << maxDiff
+              << ", output range " << lowest << ".." << highest << std::endl;
+    return pass;
+}
+
+//==============================================================================
+int main()
+{
+    static_assert(commonFrameEnd % 48 == 0 && commonFrameEnd % 64 != 0 && commonFrameEnd % controlBlockSize == 0,
+                  "frames of both hosts have to end on commonFrameEnd");
+
+    bool pass = true;
+
+    const std::vector<float> dc((size_t)length, 0.8f);
+    pass &= check("LFO", [](AudioProcessor& processor) {
+        setParameter(processor, "mod1Source", 0); // LFO 1
+        setParameter(processor, "lfo1Shape", 0);  // sine
+        setParameter(processor, "lfo1Rate", 5.0f);
+    }, dc);
+
+    // attack then release, the level only changes on a shared frame end
+    std::vector<float> step((size_t)length, 0.2f);
+    std::fill(step.begin(), step.begin() + length / 2, 0.8f);
+    pass &= check("input envelope", [](AudioProcessor& processor) {
+        setParameter(processor, "mod1Source", 2); // Input Env
+        setParameter(processor, "envAttack", 40.0f);
+        setParameter(processor, "envRelease", 200.0f);
+    }, step);
+
+    return pass ? 0 : 1;
+}
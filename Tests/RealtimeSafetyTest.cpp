@@ -0,0 +1,464 @@
+/*
+  ==============================================================================
+
+    Real-time safety check for CrushOnYouAudioProcessor::processBlock.
+
+    Allocation (every operator new/delete form, and the malloc family on
+    glibc) and mutex / rwlock calls are intercepted for the whole test
+    executable. While processBlock runs any of them counts as a failure. Every
+    emulation x crush x mask x modRate combination is run on every bus layout
+    at block sizes 1..64, some larger ones, blocks shorter than prepared and
+    blocks bigger than prepared.
+
+    Lock interception is Linux / macOS only. On macOS it only sees calls from
+    code compiled into this executable (JUCE and the plugin), not from libc++.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+#include "TestHelpers.h"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+ #include <dlfcn.h>
+ #include <pthread.h>
+#endif
+
+using namespace juce;
+
+//==============================================================================
+// Interposers. Nothing in here may allocate or lock, they only count.
+
+namespace AudioThreadGuard
+{
+    static thread_local bool active = false;
+    static std::atomic<int> violations { 0 };
+    static std::atomic<const char*> firstViolation { nullptr };
+
+    static void note(const char* what)
+    {
+        if (! active)
+            return;
+
+        const char* expected = nullptr;
+        firstViolation.compare_exchange_strong(expected, what);
+        ++violations;
+    }
+
+    struct Scope
+    {
+        Scope()  { active = true; }
+        ~Scope() { active = false; }
+    };
+}
+
+static void* alignedAllocate(std::size_t size, std::size_t alignment)
+{
+   #if JUCE_WINDOWS
+    return _aligned_malloc(size > 0 ? size : 1, alignment);
+   #else
+    void* p = nullptr;
+    return posix_memalign(&p, jmax(alignment, sizeof(void*)), size > 0 ? size : 1) == 0 ? p : nullptr;
+   #endif
+}
+
+static void alignedFree(void* p)
+{
+   #if JUCE_WINDOWS
+    _aligned_free(p);
+   #else
+    std::free(p);
+   #endif
+}
+
+void* operator new (std::size_t size)
+{
+    AudioThreadGuard::note("operator new");
+    if (void* p = std::malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)
+{
+    AudioThreadGuard::note("operator new[]");
+    if (void* p = std::malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    AudioThreadGuard::note("operator new (nothrow)");
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept
+{
+    AudioThreadGuard::note("operator new[] (nothrow)");
+    return std::malloc(size > 0 ? size : 1);
+}
+
+// over-aligned types, alignas() wider than the default new gives
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    AudioThreadGuard::note("operator new (aligned)");
+    if (void* p = alignedAllocate(size, (std::size_t)alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment)
+{
+    AudioThreadGuard::note("operator new[] (aligned)");
+    if (void* p = alignedAllocate(size, (std::size_t)alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    AudioThreadGuard::note("operator new (aligned, nothrow)");
+    return alignedAllocate(size, (std::size_t)alignment);
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    AudioThreadGuard::note("operator new[] (aligned, nothrow)");
+    return alignedAllocate(size, (std::size_t)alignment);
+}
+
+void operator delete (void* p) noexcept                   { if (p != nullptr) AudioThreadGuard::note("operator delete");   std::free(p); }
+void operator delete[] (void* p) noexcept                 { if (p != nullptr) AudioThreadGuard::note("operator delete[]"); std::free(p); }
+void operator delete (void* p, std::size_t) noexcept      { if (p != nullptr) AudioThreadGuard::note("operator delete");   std::free(p); }
+void operator delete[] (void* p, std::size_t) noexcept    { if (p != nullptr) AudioThreadGuard::note("operator delete[]"); std::free(p); }
+
+void operator delete (void* p, std::align_val_t) noexcept                 { if (p != nullptr) AudioThreadGuard::note("operator delete (aligned)");   alignedFree(p); }
+void operator delete[] (void* p, std::align_val_t) noexcept               { if (p != nullptr) AudioThreadGuard::note("operator delete[] (aligned)"); alignedFree(p); }
+void operator delete (void* p, std::size_t, std::align_val_t) noexcept    { if (p != nullptr) AudioThreadGuard::note("operator delete (aligned)");   alignedFree(p); }
+void operator delete[] (void* p, std::size_t, std::align_val_t) noexcept  { if (p != nullptr) AudioThreadGuard::note("operator delete[] (aligned)"); alignedFree(p); }
+
+#if JUCE_LINUX && defined (__GLIBC__)
+// HeapBlock and friends go straight to malloc, glibc lets us wrap it without dlsym
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void* __libc_memalign (size_t, size_t);
+    void  __libc_free (void*);
+
+    void* malloc (size_t size)                      { AudioThreadGuard::note("malloc");        return __libc_malloc(size); }
+    void* calloc (size_t num, size_t size)          { AudioThreadGuard::note("calloc");        return __libc_calloc(num, size); }
+    void* realloc (void* p, size_t size)            { AudioThreadGuard::note("realloc");       return __libc_realloc(p, size); }
+    void* memalign (size_t align, size_t size)      { AudioThreadGuard::note("memalign");      return __libc_memalign(align, size); }
+    void* aligned_alloc (size_t align, size_t size) { AudioThreadGuard::note("aligned_alloc"); return __libc_memalign(align, size); }
+    void  free (void* p)                            { if (p != nullptr) AudioThreadGuard::note("free"); __libc_free(p); }
+
+    int posix_memalign (void** p, size_t align, size_t size)
+    {
+        AudioThreadGuard::note("posix_memalign");
+        *p = __libc_memalign(align, size);
+        return *p != nullptr ? 0 : ENOMEM;
+    }
+}
+#endif
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+// Looks the real function up on first use. No static guard, that may take a
+// mutex itself; a racing first call just resolves it twice.
+template <typename Fn>
+static Fn resolveNext(Fn& next, const char* name)
+{
+    if (next == nullptr)
+        next = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+    return next;
+}
+
+extern "C"
+{
+    int pthread_mutex_lock (pthread_mutex_t* m)
+    {
+        static decltype(&pthread_mutex_lock) next = nullptr;
+        AudioThreadGuard::note("pthread_mutex_lock");
+        return resolveNext(next, "pthread_mutex_lock")(m);
+    }
+
+    int pthread_mutex_trylock (pthread_mutex_t* m)
+    {
+        static decltype(&pthread_mutex_trylock) next = nullptr;
+        AudioThreadGuard::note("pthread_mutex_trylock");
+        return resolveNext(next, "pthread_mutex_trylock")(m);
+    }
+
+    // std::shared_mutex
+    int pthread_rwlock_rdlock (pthread_rwlock_t* rw)
+    {
+        static decltype(&pthread_rwlock_rdlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_rdlock");
+        return resolveNext(next, "pthread_rwlock_rdlock")(rw);
+    }
+
+    int pthread_rwlock_wrlock (pthread_rwlock_t* rw)
+    {
+        static decltype(&pthread_rwlock_wrlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_wrlock");
+        return resolveNext(next, "pthread_rwlock_wrlock")(rw);
+    }
+
+    int pthread_rwlock_tryrdlock (pthread_rwlock_t* rw)
+    {
+        static decltype(&pthread_rwlock_tryrdlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_tryrdlock");
+        return resolveNext(next, "pthread_rwlock_tryrdlock")(rw);
+    }
+
+    int pthread_rwlock_trywrlock (pthread_rwlock_t* rw)
+    {
+        static decltype(&pthread_rwlock_trywrlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_trywrlock");
+        return resolveNext(next, "pthread_rwlock_trywrlock")(rw);
+    }
+
+   #if ! JUCE_MAC // no timed locks there
+    int pthread_mutex_timedlock (pthread_mutex_t* m, const struct timespec* timeout)
+    {
+        static decltype(&pthread_mutex_timedlock) next = nullptr;
+        AudioThreadGuard::note("pthread_mutex_timedlock");
+        return resolveNext(next, "pthread_mutex_timedlock")(m, timeout);
+    }
+
+    int pthread_rwlock_timedrdlock (pthread_rwlock_t* rw, const struct timespec* timeout)
+    {
+        static decltype(&pthread_rwlock_timedrdlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_timedrdlock");
+        return resolveNext(next, "pthread_rwlock_timedrdlock")(rw, timeout);
+    }
+
+    int pthread_rwlock_timedwrlock (pthread_rwlock_t* rw, const struct timespec* timeout)
+    {
+        static decltype(&pthread_rwlock_timedwrlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_timedwrlock");
+        return resolveNext(next, "pthread_rwlock_timedwrlock")(rw, timeout);
+    }
+   #endif
+
+   #if defined (__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 30)
+    // what libstdc++'s timed mutexes and try_lock_for use on newer glibc
+    int pthread_mutex_clocklock (pthread_mutex_t* m, clockid_t clock, const struct timespec* timeout)
+    {
+        static decltype(&pthread_mutex_clocklock) next = nullptr;
+        AudioThreadGuard::note("pthread_mutex_clocklock");
+        return resolveNext(next, "pthread_mutex_clocklock")(m, clock, timeout);
+    }
+
+    int pthread_rwlock_clockrdlock (pthread_rwlock_t* rw, clockid_t clock, const struct timespec* timeout)
+    {
+        static decltype(&pthread_rwlock_clockrdlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_clockrdlock");
+        return resolveNext(next, "pthread_rwlock_clockrdlock")(rw, clock, timeout);
+    }
+
+    int pthread_rwlock_clockwrlock (pthread_rwlock_t* rw, clockid_t clock, const struct timespec* timeout)
+    {
+        static decltype(&pthread_rwlock_clockwrlock) next = nullptr;
+        AudioThreadGuard::note("pthread_rwlock_clockwrlock");
+        return resolveNext(next, "pthread_rwlock_clockwrlock")(rw, clock, timeout);
+    }
+   #endif
+}
+#endif
+
+//==============================================================================
+// Every modulation path busy so the whole kernel / matrix / telemetry code runs
+static void setBusyParameters(AudioProcessor& processor)
+{
+    setParameter(processor, "Mix", 0.3f);
+    setParameter(processor, "dsFactor", 5);
+    setParameter(processor, "bitDepth", 10);
+    setParameter(processor, "mask3", 1);
+    setParameter(processor, "mask10", 1);
+    setParameter(processor, "mask22", 1);
+    setParameter(processor, "scAmount", 0.7f);
+    setParameter(processor, "maskDensity", 0.6f);
+    setParameter(processor, "lfo1Rate", 7.0f);
+    setParameter(processor, "lfo1Shape", 0);
+    setParameter(processor, "lfo2Rate", 3.0f);
+    setParameter(processor, "lfo2Shape", 4); // S&H
+
+    // one slot per destination, each from a different source
+    const float amounts[] = { 0.4f, -0.5f, 0.6f, -0.8f };
+    for (int slot = 0; slot < 4; slot++) {
+        const String num(slot + 1);
+        setParameter(processor, "mod" + num + "Source", (float)slot);
+        setParameter(processor, "mod" + num + "Dest", (float)((slot + 1) % 4));
+        setParameter(processor, "mod" + num + "Amount", amounts[slot]);
+    }
+}
+
+static void fillNoise(AudioBuffer<float>& buffer, Random& random)
+{
+    for (int ch = 0; ch < buffer.getNumChannels(); ch++) {
+        auto* data = buffer.getWritePointer(ch);
+        for (int i = 0; i < buffer.getNumSamples(); i++)
+            data[i] = random.nextFloat() * 1.6f - 0.8f;
+    }
+}
+
+// Renders with the guard on and returns how many violations it caused
+static int renderGuarded(AudioProcessor& processor, AudioBuffer<float>& storage, int numSamples, MidiBuffer& midi)
+{
+    // a view onto preallocated storage, made before the guard goes up
+    AudioBuffer<float> block(storage.getArrayOfWritePointers(), storage.getNumChannels(), numSamples);
+
+    const int before = AudioThreadGuard::violations.load();
+    {
+        AudioThreadGuard::Scope guard;
+        processor.processBlock(block, midi);
+    }
+    return AudioThreadGuard::violations.load() - before;
+}
+
+// Every interposer has to see its call before a pass means anything
+static bool interposersActive()
+{
+    struct alignas(64) Wide { float data[16]; };
+    std::mutex mutex;
+    std::shared_mutex sharedMutex;
+    std::timed_mutex timedMutex;
+
+    // volatile pointers so the allocation pairs can't be optimised away
+    const std::pair<const char*, std::function<void()>> probes[] = {
+        { "operator new",           [] { int* volatile p = new int(1); delete p; } },
+        { "aligned operator new",   [] { Wide* volatile p = new Wide(); delete p; } },
+       #if JUCE_LINUX && defined (__GLIBC__)
+        { "malloc",                 [] { void* volatile p = std::malloc(16); std::free(p); } },
+        { "aligned_alloc",          [] { void* volatile p = aligned_alloc(64, 64); std::free(p); } },
+       #endif
+       #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+        { "std::mutex",             [&] { mutex.lock(); mutex.unlock(); } },
+        { "std::shared_mutex read", [&] { sharedMutex.lock_shared(); sharedMutex.unlock_shared(); } },
+        { "std::shared_mutex",      [&] { sharedMutex.lock(); sharedMutex.unlock(); } },
+        { "std::timed_mutex",       [&] { if (timedMutex.try_lock_for(std::chrono::milliseconds(1))) timedMutex.unlock(); } },
+       #endif
+       #if JUCE_LINUX || JUCE_BSD
+        { "pthread_mutex_timedlock", [&] {
+              struct timespec past {}; // free mutex, so it locks straight away
+              if (pthread_mutex_timedlock(mutex.native_handle(), &past) == 0)
+                  mutex.unlock();
+          } },
+       #endif
+    };
+
+    bool allActive = true;
+    for (const auto& [name, probe] : probes) {
+        const int before = AudioThreadGuard::violations.load();
+        {
+            AudioThreadGuard::Scope guard;
+            probe();
+        }
+        if (AudioThreadGuard::violations.load() == before) {
+            std::cerr << "interposer for " << name << " isn't active, test is meaningless" << std::endl;
+            allActive = false;
+        }
+    }
+
+    AudioThreadGuard::violations = 0;
+    AudioThreadGuard::firstViolation = nullptr;
+    return allActive;
+}
+
+//==============================================================================
+int main()
+{
+    if (! interposersActive())
+        return 1;
+
+    struct Layout { const char* name; AudioChannelSet main, sidechain; };
+    const Layout layouts[] = {
+        { "stereo",           AudioChannelSet::stereo(), AudioChannelSet::disabled() },
+        { "stereo+sidechain", AudioChannelSet::stereo(), AudioChannelSet::stereo() },
+        { "mono",             AudioChannelSet::mono(),   AudioChannelSet::disabled() },
+    };
+
+    std::vector<int> blockSizes;
+    for (int size = 1; size <= 64; size++)
+        blockSizes.push_back(size);
+    for (int size : { 96, 100, 127, 128, 256, 441, 480, 512, 1000, 1024, 2048, 4096 })
+        blockSizes.push_back(size);
+
+    const char* emulations[] = { "off", "SP-1200", "S950", "MPC60" };
+    constexpr double sampleRate = 48000.0;
+
+    Random random(0x5eed);
+    MidiBuffer midi;
+    int failures = 0, runs = 0;
+
+    for (const auto& layout : layouts)
+    for (int emulation = 0; emulation < 4; emulation++)
+    for (int crush = 0; crush < 2; crush++)
+    for (int masks = 0; masks < 2; masks++)
+    for (int modRate = 0; modRate < 4; modRate++)
+    {
+        CrushOnYouAudioProcessor processor;
+
+        AudioProcessor::BusesLayout busesLayout;
+        busesLayout.inputBuses.add(layout.main);
+        busesLayout.inputBuses.add(layout.sidechain);
+        busesLayout.outputBuses.add(layout.main);
+        if (! processor.setBusesLayout(busesLayout)) {
+            std::cerr << "layout " << layout.name << " rejected" << std::endl;
+            return 1;
+        }
+
+        setBusyParameters(processor);
+        setParameter(processor, "emulation", (float)emulation);
+        setParameter(processor, "crushMethod", (float)crush);
+        setParameter(processor, "masksEnabled", (float)masks);
+        setParameter(processor, "modRate", (float)modRate);
+        processor.setTelemetryEnabled(true);
+
+        const int numChannels = jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+
+        for (int blockSize : blockSizes)
+        {
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor.prepareToPlay(sampleRate, blockSize);
+
+            // room for an oversized block, hosts don't always keep their promise
+            AudioBuffer<float> storage(numChannels, blockSize * 3 + 1);
+            fillNoise(storage, random);
+
+            int violations = 0;
+            for (int i = 0; i < 4; i++)
+                violations += renderGuarded(processor, storage, blockSize, midi);
+            violations += renderGuarded(processor, storage, jmax(1, blockSize / 2), midi); // shorter than prepared
+            violations += renderGuarded(processor, storage, 1, midi);
+            violations += renderGuarded(processor, storage, blockSize * 3 + 1, midi);    // longer than prepared
+
+            runs++;
+            if (violations > 0) {
+                failures++;
+                const char* what = AudioThreadGuard::firstViolation.exchange(nullptr);
+                std::cerr << "FAIL " << layout.name
+                          << " emulation=" << emulations[emulation]
+                          << " crush=" << crush << " masks=" << masks << " modRate=" << modRate
+                          << " blockSize=" << blockSize
+                          << ": " << violations << " call(s), first " << (what != nullptr ? what : "?") << std::endl;
+            }
+        }
+
+        processor.releaseResources();
+    }
+
+    std::cout << runs << " configurations, " << failures << " failed" << std::endl;
+    return failures > 0 ? 1 : 0;
+}
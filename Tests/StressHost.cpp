@@ -0,0 +1,326 @@
+/*
+  ==============================================================================
+
+    Headless multi-instance benchmark for CrushOnYouAudioProcessor.
+
+    Builds an AudioProcessorGraph with N instances either in series (one chain)
+    or in parallel (all fed from the input, summed at the output), randomises
+    every parameter from a fixed seed and renders at several block sizes.
+    Reports the graph callback time as percentiles and as a share of the
+    real-time budget, each instance's own processBlock time and the heap every
+    instance costs once prepared. With --telemetry every instance gathers
+    signal statistics and each one's published snapshot is printed after its
+    configuration, read through getTelemetry() like any other host would.
+
+      StressHost [--instances 1,10,50] [--blocks 64,512] [--seconds 2]
+                 [--rate 48000] [--telemetry] [--quick]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <new>
+
+#if JUCE_LINUX && defined (__GLIBC__)
+ #include <malloc.h>
+#endif
+
+using namespace juce;
+
+//==============================================================================
+// Live heap bytes for the whole process. On glibc malloc itself is wrapped so
+// HeapBlock and the STL are counted too, elsewhere only operator new is.
+
+namespace HeapCounter
+{
+    static std::atomic<int64> live { 0 };
+}
+
+#if JUCE_LINUX && defined (__GLIBC__)
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void* __libc_memalign (size_t, size_t);
+    void  __libc_free (void*);
+
+    static void* counted(void* p)
+    {
+        if (p != nullptr)
+            HeapCounter::live += (int64)malloc_usable_size(p);
+        return p;
+    }
+
+    void* malloc (size_t size)                      { return counted(__libc_malloc(size)); }
+    void* calloc (size_t num, size_t size)          { return counted(__libc_calloc(num, size)); }
+    void* memalign (size_t align, size_t size)      { return counted(__libc_memalign(align, size)); }
+    void* aligned_alloc (size_t align, size_t size) { return counted(__libc_memalign(align, size)); }
+
+    int posix_memalign (void** p, size_t align, size_t size)
+    {
+        *p = counted(__libc_memalign(align, size));
+        return *p != nullptr ? 0 : ENOMEM;
+    }
+
+    void* realloc (void* p, size_t size)
+    {
+        const int64 before = p != nullptr ? (int64)malloc_usable_size(p) : 0;
+        void* moved = __libc_realloc(p, size);
+        if (moved != nullptr)
+            HeapCounter::live += (int64)malloc_usable_size(moved) - before;
+        else if (size == 0)
+            HeapCounter::live -= before; // realloc(p, 0) frees
+        return moved;
+    }
+
+    void free (void* p)
+    {
+        if (p != nullptr)
+            HeapCounter::live -= (int64)malloc_usable_size(p);
+        __libc_free(p);
+    }
+}
+#else
+// size header in front of every block, kept at max alignment
+static constexpr size_t heapHeader = alignof(std::max_align_t);
+
+static void* countedNew(size_t size)
+{
+    auto* block = static_cast<char*>(std::malloc(size + heapHeader));
+    if (block == nullptr)
+        return nullptr;
+    *reinterpret_cast<size_t*>(block) = size;
+    HeapCounter::live += (int64)size;
+    return block + heapHeader;
+}
+
+static void countedDelete(void* p)
+{
+    if (p == nullptr)
+        return;
+    auto* block = static_cast<char*>(p) - heapHeader;
+    HeapCounter::live -= (int64)*reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+
+void* operator new (std::size_t size)   { if (void* p = countedNew(size)) return p; throw std::bad_alloc(); }
+void* operator new[] (std::size_t size) { if (void* p = countedNew(size)) return p; throw std::bad_alloc(); }
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept   { return countedNew(size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept { return countedNew(size); }
+void operator delete (void* p) noexcept                { countedDelete(p); }
+void operator delete[] (void* p) noexcept              { countedDelete(p); }
+void operator delete (void* p, std::size_t) noexcept   { countedDelete(p); }
+void operator delete[] (void* p, std::size_t) noexcept { countedDelete(p); }
+#endif
+
+//==============================================================================
+// The plugin with a stopwatch around its own processBlock
+class TimedCrush : public CrushOnYouAudioProcessor
+{
+public:
+    void processBlock(AudioBuffer<float>& buffer, MidiBuffer& midi) override
+    {
+        const int64 start = Time::getHighResolutionTicks();
+        CrushOnYouAudioProcessor::processBlock(buffer, midi);
+        const int64 elapsed = Time::getHighResolutionTicks() - start;
+
+        totalTicks += elapsed;
+        maxTicks = jmax(maxTicks, elapsed);
+        calls++;
+    }
+
+    void resetTimes() { totalTicks = maxTicks = calls = 0; }
+
+    int64 totalTicks = 0, maxTicks = 0, calls = 0;
+};
+
+static void randomiseParameters(AudioProcessor& processor, Random& random)
+{
+    for (auto* param : processor.getParameters())
+        param->setValueNotifyingHost(random.nextFloat());
+}
+
+static Array<int> parseList(const ArgumentList& args, const String& option, Array<int> fallback)
+{
+    if (! args.containsOption(option))
+        return fallback;
+
+    Array<int> values;
+    for (auto& token : StringArray::fromTokens(args.getValueForOption(option), ",", ""))
+        if (token.getIntValue() > 0)
+            values.add(token.getIntValue());
+    return values.isEmpty() ? fallback : values;
+}
+
+static double ticksToMicros(int64 ticks)
+{
+    return Time::highResolutionTicksToSeconds(ticks) * 1.0e6;
+}
+
+//==============================================================================
+struct Config
+{
+    bool series;
+    int numInstances, blockSize;
+    double sampleRate, seconds;
+    bool telemetry;
+};
+
+static void runConfig(const Config& config)
+{
+    AudioProcessorGraph graph;
+    using IO = AudioProcessorGraph::AudioGraphIOProcessor;
+    constexpr int numChannels = 2;
+
+    const int64 heapBefore = HeapCounter::live.load();
+
+    auto input = graph.addNode(std::make_unique<IO>(IO::audioInputNode));
+    auto output = graph.addNode(std::make_unique<IO>(IO::audioOutputNode));
+
+    Array<TimedCrush*> instances;
+    auto previous = input;
+    for (int i = 0; i < config.numInstances; i++) {
+        auto crush = std::make_unique<TimedCrush>();
+        Random seeded(0x5eed + i); // instance i sounds the same in every config
+        randomiseParameters(*crush, seeded);
+        if (config.telemetry)
+            crush->setTelemetryEnabled(true);
+        instances.add(crush.get());
+
+        auto node = graph.addNode(std::move(crush));
+        for (int ch = 0; ch < numChannels; ch++) {
+            // main bus only, the sidechain stays unconnected
+            const auto source = config.series ? previous->nodeID : input->nodeID;
+            graph.addConnection({ { source, ch }, { node->nodeID, ch } });
+            if (! config.series)
+                graph.addConnection({ { node->nodeID, ch }, { output->nodeID, ch } });
+        }
+        previous = node;
+    }
+    if (config.series)
+        for (int ch = 0; ch < numChannels; ch++)
+            graph.addConnection({ { previous->nodeID, ch }, { output->nodeID, ch } });
+
+    // on the message thread, so the render sequence is built right here
+    graph.setPlayConfigDetails(numChannels, numChannels, config.sampleRate, config.blockSize);
+    graph.prepareToPlay(config.sampleRate, config.blockSize);
+
+    const int64 heapPerInstance = (HeapCounter::live.load() - heapBefore) / config.numInstances;
+
+    // same noise every callback, the copy stays outside the timed region
+    Random random(1);
+    AudioBuffer<float> noise(numChannels, config.blockSize), buffer(numChannels, config.blockSize);
+    for (int ch = 0; ch < numChannels; ch++)
+        for (int i = 0; i < config.blockSize; i++)
+            noise.setSample(ch, i, random.nextFloat() * 1.6f - 0.8f);
+    MidiBuffer midi;
+
+    const int numCallbacks = jmax(100, (int)(config.seconds * config.sampleRate / config.blockSize));
+    std::vector<double> callbackMicros;
+    callbackMicros.reserve((size_t)numCallbacks);
+
+    auto render = [&] {
+        for (int ch = 0; ch < numChannels; ch++)
+            buffer.copyFrom(ch, 0, noise, ch, 0, config.blockSize);
+        midi.clear();
+
+        const int64 start = Time::getHighResolutionTicks();
+        graph.processBlock(buffer, midi);
+        return Time::getHighResolutionTicks() - start;
+    };
+
+    for (int i = 0; i < 10; i++) // warm up caches and the smoothers
+        render();
+    for (auto* crush : instances)
+        crush->resetTimes();
+
+    int64 totalTicks = 0;
+    for (int i = 0; i < numCallbacks; i++) {
+        const int64 ticks = render();
+        totalTicks += ticks;
+        callbackMicros.push_back(ticksToMicros(ticks));
+    }
+
+    std::sort(callbackMicros.begin(), callbackMicros.end());
+    auto percentile = [&](double p) {
+        return callbackMicros[jmin(callbackMicros.size() - 1, (size_t)(p * (double)callbackMicros.size()))];
+    };
+
+    int64 instanceTicks = 0, instanceMax = 0, instanceCalls = 0;
+    for (auto* crush : instances) {
+        instanceTicks += crush->totalTicks;
+        instanceMax = jmax(instanceMax, crush->maxTicks);
+        instanceCalls += crush->calls;
+    }
+
+    const double budgetMicros = 1.0e6 * config.blockSize / config.sampleRate;
+    const double meanMicros = ticksToMicros(totalTicks) / numCallbacks;
+
+    std::printf("%-8s %5d %6d %9.1f %7.2f%% %9.2f %9.2f %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f\n",
+                config.series ? "series" : "parallel", config.numInstances, config.blockSize,
+                ticksToMicros(totalTicks) / 1000.0, 100.0 * meanMicros / budgetMicros,
+                ticksToMicros(instanceTicks) / (double)jmax((int64)1, instanceCalls), ticksToMicros(instanceMax),
+                percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), callbackMicros.back(),
+                (double)heapPerInstance / 1024.0);
+
+    if (config.telemetry) {
+        int index = 0;
+        for (auto* crush : instances) {
+            const Telemetry t = crush->getTelemetry();
+            std::printf("    #%-4d SNR %6.1f dB  ENOB %5.2f  in RMS %.3f  out RMS %.3f  peak %.3f  clipped %llu  NaN in/out %llu/%llu\n",
+                        ++index, t.snrDb, t.effectiveBits, t.inputRms, t.outputRms, t.outputPeak,
+                        (unsigned long long)t.clippedSamples,
+                        (unsigned long long)t.nanInputSamples, (unsigned long long)t.nanSamples);
+        }
+    }
+    std::fflush(stdout);
+
+    graph.releaseResources();
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser; // the graph needs a message manager
+    ArgumentList args(argc, argv);
+
+    const bool quick = args.containsOption("--quick");
+    const auto instanceCounts = parseList(args, "--instances", quick ? Array<int> { 1, 10 } : Array<int> { 1, 10, 50, 100, 200 });
+    const auto blockSizes = parseList(args, "--blocks", quick ? Array<int> { 64, 512 } : Array<int> { 32, 64, 128, 256, 512, 1024 });
+    const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+    const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : (quick ? 0.1 : 2.0);
+    const bool telemetry = args.containsOption("--telemetry");
+
+    // What an instance costs on its own, before any graph overhead. The first
+    // one also builds the converter tables every instance shares.
+    {
+        const int64 start = HeapCounter::live.load();
+        auto first = std::make_unique<CrushOnYouAudioProcessor>();
+        first->prepareToPlay(sampleRate, blockSizes.getLast());
+        const int64 afterFirst = HeapCounter::live.load();
+        auto second = std::make_unique<CrushOnYouAudioProcessor>();
+        second->prepareToPlay(sampleRate, blockSizes.getLast());
+        const int64 perInstance = HeapCounter::live.load() - afterFirst;
+
+        std::printf("per instance: sizeof %d bytes, %.1f KB heap after prepareToPlay(%g, %d), plus %.1f KB shared\n\n",
+                    (int)sizeof(CrushOnYouAudioProcessor), (double)perInstance / 1024.0,
+                    sampleRate, blockSizes.getLast(), (double)(afterFirst - start - perInstance) / 1024.0);
+    }
+
+    std::printf("%-8s %5s %6s %9s %8s %9s %9s %9s %9s %9s %9s %9s %10s\n",
+                "topology", "N", "block", "total ms", "budget", "inst us", "inst max",
+                "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "heap/N KB");
+
+    for (bool series : { true, false })
+        for (int numInstances : instanceCounts)
+            for (int blockSize : blockSizes)
+                runConfig({ series, numInstances, blockSize, sampleRate, seconds, telemetry });
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    Headless check of the published telemetry snapshot.
+
+    Renders known signals and reads getTelemetry() the way a test host would:
+    an 8-bit QL crush of a full-scale sine has to come out at about 8 effective
+    bits, with or without decimation. The emulated converters have to keep
+    their bits even though their filters and resampling delay the signal. NaN
+    input has to be counted without making the SNR non-finite, and with the
+    switch off nothing may be published.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+#include "TestHelpers.h"
+
+#include <functional>
+#include <iostream>
+
+using namespace juce;
+
+//==============================================================================
+static constexpr double sampleRate = 48000.0;
+static constexpr int blockSize = 480;
+static constexpr int numBlocks = 100; // one second, ten telemetry windows
+
+using Setup = std::function<void(CrushOnYouAudioProcessor&)>;
+using Signal = std::function<float(int)>;
+
+static Telemetry render(const Setup& setup, const Signal& signal, bool telemetryOn = true)
+{
+    CrushOnYouAudioProcessor processor;
+    setParameter(processor, "Mix", 1.0f); // fully wet
+    setParameter(processor, "masksEnabled", 0);
+    setup(processor);
+    processor.setTelemetryEnabled(telemetryOn);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    const int numChannels = jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    AudioBuffer<float> block(numChannels, blockSize);
+    MidiBuffer midi;
+
+    for (int b = 0; b < numBlocks; b++) {
+        for (int ch = 0; ch < numChannels; ch++)
+            for (int i = 0; i < blockSize; i++)
+                block.setSample(ch, i, signal(b * blockSize + i));
+
+        processor.processBlock(block, midi);
+    }
+
+    processor.releaseResources();
+    return processor.getTelemetry();
+}
+
+static bool expect(bool condition, const String& what, const Telemetry& t)
+{
+    std::cout << (condition ? "PASS " : "FAIL ") << what
+              << ": SNR " << t.snrDb << " dB, ENOB " << t.effectiveBits
+              << ", in RMS " << t.inputRms << ", out RMS " << t.outputRms
+              << ", NaN in/out " << (int)t.nanInputSamples << "/" << (int)t.nanSamples << std::endl;
+    return condition;
+}
+
+static float sine(int i, double hz)
+{
+    return (float)std::sin(MathConstants<double>::twoPi * hz * i / sampleRate);
+}
+
+//==============================================================================
+int main()
+{
+    bool pass = true;
+
+    // Crush at the quantizer: ENOB of an 8-bit QL crush. QL truncates towards
+    // zero, which costs the bit its 255 steps either side of zero would add.
+    const Signal fullScale = [](int i) { return sine(i, 997.0); };
+    for (int factor : { 1, 4 }) {
+        const auto t = render([factor](auto& p) {
+            setParameter(p, "bitDepth", 8);
+            setParameter(p, "crushMethod", 0);
+            setParameter(p, "dsFactor", (float)factor);
+        }, fullScale);
+        pass &= expect(std::abs(t.effectiveBits - 8.0f) < 0.3f,
+                       "8-bit QL, dsFactor " + String(factor) + ", ENOB ~ 8", t);
+    }
+
+    // Emulated 12-bit converters. Measured against the output, their filter and
+    // resampler delay made these read 1-1.5 bits. The ladder weight errors and,
+    // on SP-1200 and MPC60, the coarser steps at the top of the saturated or
+    // companded range really do cost a few bits (with ideal ladders the S950
+    // reads 11.4, the textbook figure for this level).
+    const Signal twoTone = [](int i) { return 0.45f * sine(i, 220.0) + 0.45f * sine(i, 1500.0); };
+    const char* models[] = { "SP-1200", "S950", "MPC60" };
+    for (int model = 0; model < 3; model++) {
+        const auto t = render([model](auto& p) {
+            setParameter(p, "emulation", (float)(model + 1));
+        }, twoTone);
+        pass &= expect(t.effectiveBits > 5.0f, String(models[model]) + " two-tone, ENOB > 5", t);
+    }
+
+    // One NaN and one inf per channel: counted, sums stay finite
+    const Signal poisoned = [&](int i) {
+        if (i == 1000) return std::numeric_limits<float>::quiet_NaN();
+        if (i == 30000) return std::numeric_limits<float>::infinity();
+        return fullScale(i);
+    };
+    {
+        CrushOnYouAudioProcessor probe;
+        const int numChannels = probe.getMainBusNumInputChannels();
+        const auto t = render([](auto& p) { setParameter(p, "bitDepth", 8); }, poisoned);
+        pass &= expect((int)t.nanInputSamples == 2 * numChannels && std::isfinite(t.snrDb) && std::isfinite(t.effectiveBits),
+                       "NaN / inf input counted, SNR finite", t);
+    }
+
+    // switched off: nothing measured, nothing published
+    {
+        const auto t = render([](auto& p) { setParameter(p, "bitDepth", 8); }, fullScale, false);
+        pass &= expect(t.inputRms == 0.0f && t.snrDb == 0.0f, "telemetry off publishes nothing", t);
+    }
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+/*
+  ==============================================================================
+
+    Small helpers shared by the headless test hosts.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <iostream>
+
+using namespace juce;
+
+//==============================================================================
+// Sets a parameter by ID in its own units, the way a host automating it would
+inline void setParameter(AudioProcessor& processor, const String& paramID, float plainValue)
+{
+    for (auto* param : processor.getParameters())
+        if (auto* ranged = dynamic_cast<RangedAudioParameter*>(param))
+            if (ranged->paramID == paramID) {
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(plainValue));
+                return;
+            }
+
+    std::cerr << "no parameter " << paramID << std::endl;
+    jassertfalse;
+}